@@ -0,0 +1,72 @@
+#pragma once
+#include "camera.hpp"
+#include "checkpoint.hpp"
+#include "hittable.hpp"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Renders many camera jobs against one loaded scene.
+//
+// The manifest holds one job per line as key=value pairs, keys that are left out keep the
+// value of the base camera. Lines starting with '#' are comments.
+//   output=turntable_000.png lookfrom=13,2,3 lookat=0,0,0 vup=0,1,0 vfov=20 focus_dist=10
+//   dof_angle=0.6 width=1000 aspect=1.7778 samples=250 max_depth=50
+// Tiles of every job go through the same worker threads in manifest order, so the tail of a
+// job overlaps with the start of the next one. When m_checkpoint_prefix is set, job n keeps its
+// accumulation state in <prefix>.<n> and picks it up again on the next run. A finished job leaves
+// a completion marker there so that a rerun skips it, the files are deleted once every job of the
+// batch succeeded.
+class Batch
+{
+  private:
+    struct Job
+    {
+        Camera cam;
+        std::string checkpoint_path;
+        std::unique_ptr<accumulation_t> acc; // Allocated when the first tile of the job starts
+        std::unique_ptr<Checkpoint> checkpoint;
+        std::once_flag allocated;
+        std::atomic<bool> started = false;
+        std::atomic<int> remaining; // Tiles left before the image can be written
+        std::mutex checkpoint_mutex; // Keeps checkpoint updates away from the end of the job
+        bool finished = false;
+    };
+    struct Tile
+    {
+        size_t job, block;
+    };
+
+    const Hittable &m_world;
+    uint64_t m_scene; // Fingerprint of m_world, stored in every job checkpoint
+    Camera m_base;
+    std::deque<Job> m_jobs;
+    std::vector<Tile> m_tiles;
+    std::atomic<size_t> m_next_tile = 0;
+    std::atomic<bool> m_failed = false;
+    std::mutex m_log_mutex;
+    std::atomic<size_t> m_jobs_done = 0;
+    static constexpr int block_size = 128;
+
+    bool parse_job(const std::string &line, Camera &cam) const;
+    void work();
+    void start(Job &job);
+    void finish(Job &job);
+
+  public:
+    int m_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string m_checkpoint_prefix;    // Checkpointing is off when empty
+    double m_checkpoint_interval = 5.0; // Seconds between two checkpoints of a job
+
+    Batch(const Hittable &world, const Camera &base)
+        : m_world(world), m_scene(world.fingerprint(utils::fnv_offset_basis)), m_base(base)
+    {
+    }
+    bool load(const std::string &manifest);
+    bool run();
+};
@@ -3,10 +3,15 @@
 #include "hittable.hpp"
 #include "ray.hpp"
 #include "vec3.hpp"
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <string>
 
 class Camera;
+struct accumulation_t;
 struct Task
 {
 
@@ -16,8 +21,29 @@ struct Task
         int x0, y0, x1, y1;
     };
 
-    void render_block(const block &b, const Hittable &world, std::vector<unsigned char> &image_data, int channels,
-                      const Camera &cam);
+    // Sampler seed of one pass over a block, makes renders independent of thread scheduling
+    static uint64_t seed(uint64_t block_index, int sample) { return (block_index << 32) | uint32_t(sample); }
+
+    // Brings block k of acc up to samples passes, one pass at a time, publishing each pass under its lock.
+    // A pass interrupted by acc.cancel is dropped.
+    void sample_block(size_t k, const Hittable &world, accumulation_t &acc, const Camera &cam, int samples);
+};
+
+// Color sums of a render in progress. Blocks are published one whole pass at a time,
+// so a single sample count per block describes all of its pixels.
+struct accumulation_t
+{
+    int width, height, block_size;
+    std::vector<Task::block> blocks;
+    std::vector<float> sums;       // RGB sums, 3 per pixel
+    std::vector<uint32_t> counts;  // Samples accumulated, per block
+    std::vector<std::mutex> locks; // Guards the pixels and the count of each block
+    const std::atomic<bool> *cancel = nullptr; // Stops sampling at the next row once raised
+
+    accumulation_t(const Camera &cam, int block_size);
+    // Averages the sums of block k into pixels, blocks without samples are left alone
+    void resolve_block(size_t k, std::vector<unsigned char> &pixels, int channels) const;
+    std::vector<unsigned char> resolve(int channels) const;
 };
 
 class Camera
@@ -30,7 +56,6 @@ class Camera
     Point3 m_pixel00_loc;            // Location of pixel 0, 0
     Vec3 m_pixel_delta_u;            // Offset to pixel to the right
     Vec3 m_pixel_delta_v;            // Offset to pixel below
-    double m_pixel_samples_scale;    // Color scale factor for a sum of pixel samples
     Vec3 m_u, m_v, m_w;              // Camera basis vectors
     Vec3 m_dof_disk_u, m_dof_disk_v; // DoF disk horizontal and vertical vectors
 
@@ -39,10 +64,16 @@ class Camera
     Color ray_color(const Ray &r, int depth, const Hittable &world) const;
     Point3 dof_disk_sample() const;
 
-    std::vector<Task::block> create_tasks(int width, int height, int block_size);
+  public:
+    // Upper bounds for settings coming from clients or manifests
+    static constexpr int max_image_size = 16384;
+    static constexpr int max_samples = 1 << 20;
+    static constexpr int max_ray_depth = 10000;
+
+    static std::vector<Task::block> create_tasks(int width, int height, int block_size);
     void init();
+    int image_height() const { return m_image_height; }
 
-  public:
     double m_aspect_ratio = 16.0 / 9.0;
     int m_image_width = 1280;
     int m_samples_per_pixel = 10; // Count of random samples for each pixel
@@ -55,5 +86,9 @@ class Camera
     double m_dof_angle = 0;
     double m_focus_dist = 10;
 
+    std::string m_output_path = "image.png";
+    std::string m_checkpoint_path;      // Accumulation state is saved there when not empty
+    double m_checkpoint_interval = 5.0; // Seconds between two checkpoints
+
     void render(const Hittable &world);
 };
\ No newline at end of file
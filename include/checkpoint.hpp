@@ -0,0 +1,76 @@
+#pragma once
+#include "camera.hpp"
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// On-disk accumulation state of a render: per-pixel color sums and per-block sample counts.
+// The sampler is reseeded from (block, sample index) so the counts are all the sampler
+// state needed to resume and end up with the same image.
+//
+// The file is the header followed by one record per block at a fixed offset: a record_t, then
+// the sums of the block row by row. A save rewrites in place only the records of blocks that
+// moved since the previous one, then syncs. A record torn by a crash fails its checksum and
+// only that block starts over on restore. Once the image is written, mark_complete() can cut the
+// file down to its header as a marker that this render needs no more work.
+class Checkpoint
+{
+  public:
+    struct header_t
+    {
+        char magic[4] = {'R', 'T', 'C', 'K'};
+        uint32_t version = 4;
+        int32_t width = 0, height = 0;
+        int32_t samples_per_pixel = 0, max_depth = 0, block_size = 0;
+        int32_t complete = 0;   // Set once the image was written, the records are dropped then
+        uint64_t scene = 0;     // Hittable::fingerprint of the world
+        double camera[13] = {}; // Aspect, vfov, lookfrom, lookat, vup, DoF angle and focus distance
+
+        bool operator==(const header_t &) const = default;
+    };
+    struct record_t
+    {
+        uint64_t checksum = 0; // FNV-1a of count and sums
+        uint32_t count = 0;
+        int32_t reserved = 0;
+    };
+
+  private:
+    std::string m_path;
+    header_t m_header;
+    std::vector<Task::block> m_blocks;
+    std::vector<size_t> m_first;     // Index in m_sums of the first sum of each block, then the total
+    std::vector<float> m_sums;       // Last snapshot, laid out block by block as in the file
+    std::vector<uint32_t> m_counts;
+    std::vector<bool> m_unsaved;     // Blocks snapshotted but not written yet
+    std::future<bool> m_writer;
+    std::chrono::steady_clock::time_point m_last_save;
+    int m_fd = -1;
+    bool m_reuse = false; // The file on disk already holds this header and layout
+
+    off_t record_offset(size_t k) const;
+    uint64_t checksum(size_t k) const;
+    bool open_file();
+    // Writes the unsaved records and syncs, runs on the writer thread
+    bool save();
+
+  public:
+    double m_interval; // Seconds between two checkpoints
+
+    Checkpoint(const std::string &path, const Camera &cam, uint64_t scene, int block_size, double interval);
+    ~Checkpoint();
+    // Fills acc from the file, fails when it is missing, complete or was written for another scene or camera setup
+    bool restore(accumulation_t &acc);
+    // Whether the file is a completion marker of this render
+    bool complete() const;
+    // Waits for the save in flight and replaces the file with a completion marker
+    bool mark_complete();
+    // Snapshots the blocks of acc that moved and writes them in the background once m_interval
+    // has elapsed and the last save is done
+    void update(accumulation_t &acc);
+    // Waits for the save in flight and deletes the file
+    void remove();
+};
@@ -25,6 +25,8 @@ class Hittable
   public:
     virtual ~Hittable() = default;
     virtual bool hit(const Ray &r, Interval ray_int, hit_record_t &rec) const = 0;
+    // Folds the geometry and its materials into hash, tells checkpoints of different scenes apart
+    virtual uint64_t fingerprint(uint64_t hash) const = 0;
 };
 
 class HittableList : public Hittable
@@ -57,4 +59,12 @@ class HittableList : public Hittable
 
         return hit_anything;
     }
+
+    uint64_t fingerprint(uint64_t hash) const override
+    {
+        hash = utils::fnv1a(utils::fnv1a(hash, 'H'), m_objects.size());
+        for (const auto &object : m_objects)
+            hash = object->fingerprint(hash);
+        return hash;
+    }
 };
\ No newline at end of file
@@ -10,6 +10,8 @@ class Material
   public:
     virtual ~Material() = default;
     virtual bool scatter(const Ray &ray, const hit_record_t &hit, Color &attenuation, Ray &scattered) const = 0;
+    // Folds the kind and parameters of the material into hash
+    virtual uint64_t fingerprint(uint64_t hash) const = 0;
 };
 
 class Lambertian : public Material
@@ -29,6 +31,7 @@ class Lambertian : public Material
         attenuation = m_albedo;
         return true;
     }
+    uint64_t fingerprint(uint64_t hash) const override { return utils::fnv1a(utils::fnv1a(hash, 'L'), m_albedo); }
 };
 
 class Metal : public Material
@@ -46,6 +49,10 @@ class Metal : public Material
         attenuation = m_albedo;
         return dot(scattered.direction(), hit.normal) > 0;
     }
+    uint64_t fingerprint(uint64_t hash) const override
+    {
+        return utils::fnv1a(utils::fnv1a(utils::fnv1a(hash, 'M'), m_albedo), m_fuzz);
+    }
 };
 
 class Dielectric : public Material
@@ -82,4 +89,8 @@ class Dielectric : public Material
         scattered = Ray(hit.p, direction);
         return true;
     }
+    uint64_t fingerprint(uint64_t hash) const override
+    {
+        return utils::fnv1a(utils::fnv1a(hash, 'D'), m_refraction_index);
+    }
 };
\ No newline at end of file
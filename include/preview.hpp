@@ -0,0 +1,73 @@
+#pragma once
+#include "camera.hpp"
+#include "color.hpp"
+#include "hittable.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Long-running render service for interactive camera tuning.
+//
+// Listens on 127.0.0.1:m_port and accepts one client at a time. The client sends
+// newline separated commands:
+//   lookfrom x y z | lookat x y z | vup x y z | vfov deg | focus_dist d | dof_angle deg
+//   samples n | max_depth n | width n | format png|jpg
+// Every command cancels the tiles in flight and restarts progressive accumulation. The first
+// pass is sized from the measured throughput to fit m_first_frame_latency, the resolution then
+// doubles up to the requested width. A frame goes out every m_frame_interval, showing the blocks
+// finished so far over the previous result.
+// The server answers with frames, each one being a text header followed by the encoded image:
+//   FRAME <sequence> <samples> <width> <height> <png|jpg> <size>\n<size bytes>
+// Frames are handed to a sender thread that only keeps the latest one, so a client that reads
+// slowly misses frames (gaps in <sequence>) instead of stalling the renderer.
+// scripts/preview_client.py sends commands and saves the frames it gets back.
+class PreviewServer
+{
+  private:
+    using Clock = std::chrono::steady_clock;
+    struct frame_t
+    {
+        int width = 0, height = 0;
+        std::vector<unsigned char> pixels;
+    };
+
+    const Hittable &m_world;
+    Camera m_camera;             // Latest camera requested by the client
+    std::string m_format = "jpg";
+    std::mutex m_mutex;          // Guards m_camera, m_format, m_dirty and m_connected
+    std::condition_variable m_changed;
+    std::atomic<bool> m_cancel = false;
+    bool m_dirty = false;
+    bool m_connected = false;
+    int m_client = -1;
+    unsigned m_sequence = 0;
+    static constexpr int block_size = 64; // Smaller than a render block so mid-pass frames fill in steadily
+
+    std::mutex m_send_mutex;               // Guards m_outgoing and m_sending
+    std::condition_variable m_send_ready;
+    std::vector<unsigned char> m_outgoing; // Latest frame not handed to the socket yet
+    bool m_sending = false;                // The sender thread runs for the current client
+
+    void read_commands();
+    bool apply(const std::string &line);
+    void progressive(Camera cam, const std::string &format);
+    bool render_pass(const Camera &cam, int sample, accumulation_t &acc, frame_t &frame, const std::string &format,
+                     Clock::time_point &last_frame);
+    void send_frame(const frame_t &frame, int samples, const std::string &format);
+    void send_frames();
+
+  public:
+    int m_port = 8080;
+    int m_threads = std::max(1u, std::thread::hardware_concurrency());
+    double m_first_frame_latency = 0.1; // Target delay in seconds before the first frame of a request
+    double m_frame_interval = 0.1;      // Target delay in seconds between two streamed frames
+    double m_pixel_rate = 1e5;          // Pixel samples per second, updated after every full pass
+
+    PreviewServer(const Hittable &world, const Camera &cam) : m_world(world), m_camera(cam) {}
+    bool serve();
+};
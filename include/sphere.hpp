@@ -1,5 +1,6 @@
 #pragma once
 #include "hittable.hpp"
+#include "material.hpp"
 #include "vec3.hpp"
 
 class Sphere : public Hittable
@@ -44,4 +45,10 @@ class Sphere : public Hittable
         rec.mat = m_mat;
         return true;
     }
+
+    uint64_t fingerprint(uint64_t hash) const override
+    {
+        hash = utils::fnv1a(utils::fnv1a(utils::fnv1a(hash, 'S'), m_center), m_radius);
+        return m_mat->fingerprint(hash);
+    }
 };
\ No newline at end of file
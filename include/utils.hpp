@@ -1,6 +1,10 @@
 #pragma once
+#include <charconv>
 #include <cmath>
+#include <cstdint>
 #include <random>
+#include <string_view>
+#include <type_traits>
 
 namespace utils
 {
@@ -8,17 +12,74 @@ const double infinity = __DBL_MAX__;
 
 inline double degrees_to_radians(double degrees) { return degrees * M_PI / 180.0; }
 
+// Parses the whole of text as a T, fails on trailing characters and non-finite numbers
+template <typename T> bool parse_exact(std::string_view text, T &value)
+{
+    T parsed;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (error != std::errc() || end != text.data() + text.size())
+        return false;
+    if constexpr (std::is_floating_point_v<T>)
+        if (!std::isfinite(parsed))
+            return false;
+    value = parsed;
+    return true;
+}
+
+// FNV-1a, chaining the returned hash through several calls fingerprints a whole structure
+constexpr uint64_t fnv_offset_basis = 0xcbf29ce484222325ull;
+
+inline uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+    auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+template <typename T> uint64_t fnv1a(uint64_t hash, const T &value)
+{
+    static_assert(std::is_trivially_copyable_v<T>, "only plain values can be hashed bytewise");
+    return fnv1a(hash, &value, sizeof(value));
+}
+
+// Generators are per thread so that a render task seeded with seed_sampler draws the same
+// samples regardless of scheduling.
+inline std::mt19937 &uniform_generator()
+{
+    thread_local std::mt19937 generator;
+    return generator;
+}
+
+inline std::mt19937 &gaussian_generator()
+{
+    thread_local std::mt19937 generator;
+    return generator;
+}
+
+inline std::normal_distribution<double> &gaussian_distribution()
+{
+    thread_local std::normal_distribution<double> distribution(0.0, 1.0);
+    return distribution;
+}
+
+inline void seed_sampler(uint64_t seed)
+{
+    std::seed_seq uniform_seq{uint32_t(seed), uint32_t(seed >> 32), 0u};
+    std::seed_seq gaussian_seq{uint32_t(seed), uint32_t(seed >> 32), 1u};
+    uniform_generator().seed(uniform_seq);
+    gaussian_generator().seed(gaussian_seq);
+    gaussian_distribution().reset();
+}
+
 inline double random_double(double min = 0.0, double max = 1.0)
 {
-    static std::uniform_real_distribution<double> distribution(min, max);
-    static std::mt19937 generator;
-    return distribution(generator);
+    thread_local std::uniform_real_distribution<double> distribution(min, max);
+    return distribution(uniform_generator());
 }
 
 inline double random_gaussian(double min = 0.0, double max = 1.0)
 {
-    static std::normal_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    return gaussian_distribution()(gaussian_generator());
 }
 } // namespace utils
\ No newline at end of file
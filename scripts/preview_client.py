@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""Minimal client for `ray-tracer --serve <port>`.
+
+Sends the given commands, then saves every frame the server streams back as
+<prefix>_<sequence>.<format> until --frames frames were received or the
+server closes the connection.
+
+    ./bin/ray-tracer --serve 8090 &
+    scripts/preview_client.py 8090 "width 400" "samples 16" "lookfrom 13 2 3" --frames 20
+
+The same session by hand, frames are then only dumped to a file:
+    printf 'width 400\\nsamples 16\\n' | nc 127.0.0.1 8090 > frames.bin
+"""
+import argparse
+import socket
+
+
+def read_line(stream):
+    line = stream.readline()
+    if not line:
+        raise EOFError
+    return line.decode().rstrip("\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", type=int)
+    parser.add_argument("commands", nargs="*", help='e.g. "vfov 30" or "lookfrom 13 2 3"')
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--frames", type=int, default=10, help="frames to save before disconnecting")
+    parser.add_argument("--prefix", default="frame")
+    args = parser.parse_args()
+
+    with socket.create_connection((args.host, args.port)) as sock:
+        for command in args.commands:
+            sock.sendall((command + "\n").encode())
+        stream = sock.makefile("rb")
+        try:
+            for _ in range(args.frames):
+                # FRAME <sequence> <samples> <width> <height> <png|jpg> <size>
+                tag, sequence, samples, width, height, fmt, size = read_line(stream).split()
+                if tag != "FRAME":
+                    raise ValueError("unexpected header " + tag)
+                data = stream.read(int(size))
+                if len(data) != int(size):
+                    raise EOFError
+                path = "%s_%s.%s" % (args.prefix, sequence, fmt)
+                with open(path, "wb") as out:
+                    out.write(data)
+                print("%s: %sx%s, %s samples" % (path, width, height, samples))
+        except EOFError:
+            print("Server closed the connection")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,219 @@
+#include "batch.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string_view>
+#include <stb_image_write.h>
+
+static bool parse_vec3(const std::string &value, Vec3 &v)
+{
+    auto first = value.find(','), second = value.find(',', first + 1);
+    if (first == std::string::npos || second == std::string::npos)
+        return false;
+    double x, y, z;
+    std::string_view text(value);
+    if (!utils::parse_exact(text.substr(0, first), x) ||
+        !utils::parse_exact(text.substr(first + 1, second - first - 1), y) ||
+        !utils::parse_exact(text.substr(second + 1), z))
+        return false;
+    v = Vec3(x, y, z);
+    return true;
+}
+
+bool Batch::parse_job(const std::string &line, Camera &cam) const
+{
+    std::istringstream in(line);
+    std::string token;
+    bool has_output = false;
+    while (in >> token)
+    {
+        auto eq = token.find('=');
+        if (eq == std::string::npos)
+            return false;
+        std::string key = token.substr(0, eq);
+        std::string value = token.substr(eq + 1);
+
+        if (key == "output")
+        {
+            cam.m_output_path = value;
+            has_output = !value.empty();
+            continue;
+        }
+        if (key == "lookfrom" || key == "lookat" || key == "vup")
+        {
+            Vec3 &target = key == "lookfrom" ? cam.m_lookfrom : key == "lookat" ? cam.m_lookat : cam.m_vup;
+            if (!parse_vec3(value, target))
+                return false;
+            continue;
+        }
+
+        double number;
+        int count;
+        if (key == "vfov" && utils::parse_exact(value, number) && number > 0 && number < 180)
+            cam.m_vfov = number;
+        else if (key == "focus_dist" && utils::parse_exact(value, number) && number > 0)
+            cam.m_focus_dist = number;
+        else if (key == "dof_angle" && utils::parse_exact(value, number) && number >= 0)
+            cam.m_dof_angle = number;
+        else if (key == "width" && utils::parse_exact(value, count) && count >= 1 && count <= Camera::max_image_size)
+            cam.m_image_width = count;
+        else if (key == "aspect" && utils::parse_exact(value, number) && number > 0)
+            cam.m_aspect_ratio = number;
+        else if (key == "samples" && utils::parse_exact(value, count) && count >= 1 && count <= Camera::max_samples)
+            cam.m_samples_per_pixel = count;
+        else if (key == "max_depth" && utils::parse_exact(value, count) && count >= 1 &&
+                 count <= Camera::max_ray_depth)
+            cam.m_max_depth = count;
+        else
+            return false;
+    }
+    // The height follows from width and aspect, keep it in range as well
+    return has_output && cam.m_image_width / cam.m_aspect_ratio <= Camera::max_image_size;
+}
+
+bool Batch::load(const std::string &manifest)
+{
+    std::ifstream file(manifest);
+    if (!file)
+    {
+        std::cerr << "Cannot open manifest " << manifest << '\n';
+        return false;
+    }
+
+    std::string line;
+    std::set<std::filesystem::path> outputs;
+    for (int line_number = 1; std::getline(file, line); line_number++)
+    {
+        auto start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#')
+            continue;
+
+        Camera cam = m_base;
+        if (!parse_job(line, cam))
+        {
+            std::cerr << manifest << ':' << line_number << ": invalid job \"" << line << "\"\n";
+            return false;
+        }
+        // Two jobs writing the same file would silently lose one of the images
+        if (!outputs.insert(std::filesystem::absolute(cam.m_output_path).lexically_normal()).second)
+        {
+            std::cerr << manifest << ':' << line_number << ": output " << cam.m_output_path
+                      << " is already written by an earlier job\n";
+            return false;
+        }
+        cam.init();
+
+        Job &job = m_jobs.emplace_back();
+        job.cam = cam;
+        if (!m_checkpoint_prefix.empty())
+        {
+            job.checkpoint_path = m_checkpoint_prefix + '.' + std::to_string(m_jobs.size() - 1);
+            // Finished by an earlier run, as long as its image is still there
+            if (std::filesystem::exists(cam.m_output_path) &&
+                Checkpoint(job.checkpoint_path, cam, m_scene, block_size, m_checkpoint_interval).complete())
+            {
+                std::clog << "Skipping " << cam.m_output_path << ", already rendered\n";
+                job.remaining = 0;
+                job.finished = true;
+                m_jobs_done++;
+                continue;
+            }
+        }
+        size_t blocks = Camera::create_tasks(cam.m_image_width, cam.image_height(), block_size).size();
+        job.remaining = blocks;
+        for (size_t b = 0; b < blocks; b++)
+            m_tiles.push_back({m_jobs.size() - 1, b});
+    }
+    if (m_jobs.empty())
+    {
+        std::cerr << "No job in manifest " << manifest << '\n';
+        return false;
+    }
+    return true;
+}
+
+void Batch::start(Job &job)
+{
+    job.acc = std::make_unique<accumulation_t>(job.cam, block_size);
+    if (!job.checkpoint_path.empty())
+    {
+        job.checkpoint =
+            std::make_unique<Checkpoint>(job.checkpoint_path, job.cam, m_scene, block_size, m_checkpoint_interval);
+        if (job.checkpoint->restore(*job.acc))
+        {
+            std::lock_guard<std::mutex> lock(m_log_mutex);
+            std::clog << "\rResuming " << job.cam.m_output_path << " from " << job.checkpoint_path << '\n';
+        }
+    }
+    job.started = true;
+}
+
+void Batch::finish(Job &job)
+{
+    const int channels = 3;
+    const Camera &cam = job.cam;
+    auto image_data = job.acc->resolve(channels);
+    bool written = stbi_write_png(cam.m_output_path.c_str(), cam.m_image_width, cam.image_height(), channels,
+                                  image_data.data(), cam.m_image_width * channels);
+    {
+        std::lock_guard<std::mutex> lock(job.checkpoint_mutex);
+        job.finished = true;
+        if (written && job.checkpoint)
+            job.checkpoint->mark_complete();
+        job.checkpoint.reset();
+        job.acc.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(m_log_mutex);
+    if (!written)
+    {
+        m_failed = true;
+        std::cerr << "\rCannot write " << cam.m_output_path << '\n';
+    }
+    std::clog << "\rJobs done: " << ++m_jobs_done << '/' << m_jobs.size() << ' ' << std::flush;
+}
+
+void Batch::work()
+{
+    for (size_t t = m_next_tile++; t < m_tiles.size(); t = m_next_tile++)
+    {
+        Job &job = m_jobs[m_tiles[t].job];
+        std::call_once(job.allocated, &Batch::start, this, std::ref(job));
+        Task().sample_block(m_tiles[t].block, m_world, *job.acc, job.cam, job.cam.m_samples_per_pixel);
+        if (--job.remaining == 0)
+            finish(job);
+    }
+}
+
+bool Batch::run()
+{
+    std::vector<std::thread> workers;
+    for (int i = 0; i < m_threads; i++)
+        workers.emplace_back(&Batch::work, this);
+
+    while (!m_checkpoint_prefix.empty() && m_jobs_done < m_jobs.size())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        for (auto &job : m_jobs)
+        {
+            if (!job.started)
+                continue;
+            std::lock_guard<std::mutex> lock(job.checkpoint_mutex);
+            if (!job.finished)
+                job.checkpoint->update(*job.acc);
+        }
+    }
+    for (auto &w : workers)
+        w.join();
+
+    // Markers and checkpoints are only needed to resume a batch that did not go through
+    if (!m_failed)
+        for (const auto &job : m_jobs)
+            if (!job.checkpoint_path.empty())
+                std::remove(job.checkpoint_path.c_str());
+
+    std::clog << "\rDone.                 \n";
+    return !m_failed;
+}
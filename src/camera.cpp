@@ -1,8 +1,11 @@
 #include "camera.hpp"
+#include "checkpoint.hpp"
 #include "material.hpp"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <future>
+#include <chrono>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <stb_image_write.h>
 
 Color Camera::ray_color(const Ray &r, int depth, const Hittable &world) const
@@ -31,8 +34,6 @@ void Camera::init()
     m_image_height = int(m_image_width / m_aspect_ratio);
     m_image_height = (m_image_height < 1) ? 1 : m_image_height;
 
-    m_pixel_samples_scale = 1.0 / m_samples_per_pixel;
-
     m_center = m_lookfrom;
 
     // Determine viewport dimensions.
@@ -82,29 +83,73 @@ Ray Camera::get_ray(int i, int j) const
 
 Vec3 Camera::sample_square() const { return Vec3(utils::random_double() - .5, utils::random_double() - .5, 0); }
 
-void Task::render_block(const Task::block &b, const Hittable &world, std::vector<unsigned char> &image_data,
-                        int channels, const Camera &cam)
+void Task::sample_block(size_t k, const Hittable &world, accumulation_t &acc, const Camera &cam, int samples)
 {
-    for (int j = b.y0; j < b.y1; j++)
+    const Task::block &b = acc.blocks[k];
+    const int width = b.x1 - b.x0;
+    std::vector<Color> pass(width * (b.y1 - b.y0));
+    for (int s = acc.counts[k]; s < samples; s++)
     {
-        // progress[thread_id] = int(100 * (j - b.y0) / (b.y1 - b.y0));
-        for (int i = b.x0; i < b.x1; i++)
+        utils::seed_sampler(seed(k, s));
+        for (int j = b.y0; j < b.y1; j++)
         {
-            Color pixel_color(0, 0, 0);
-            for (int s = 0; s < cam.m_samples_per_pixel; s++)
+            if (acc.cancel && acc.cancel->load(std::memory_order_relaxed))
+                return;
+            for (int i = b.x0; i < b.x1; i++)
+                pass[(j - b.y0) * width + (i - b.x0)] = cam.ray_color(cam.get_ray(i, j), cam.m_max_depth, world);
+        }
+
+        std::lock_guard<std::mutex> guard(acc.locks[k]);
+        for (int j = b.y0; j < b.y1; j++)
+        {
+            for (int i = b.x0; i < b.x1; i++)
             {
-                Ray r = cam.get_ray(i, j);
-                pixel_color += cam.ray_color(r, cam.m_max_depth, world);
+                const Color &c = pass[(j - b.y0) * width + (i - b.x0)];
+                float *sum = &acc.sums[(size_t(j) * acc.width + i) * 3];
+                sum[0] += c.x();
+                sum[1] += c.y();
+                sum[2] += c.z();
             }
-            auto c = Color::prepare_color(pixel_color * cam.m_pixel_samples_scale);
-            int index = (j * cam.m_image_width + i) * channels;
-            image_data[index] = c.x();
-            image_data[index + 1] = c.y();
-            image_data[index + 2] = c.z();
+        }
+        acc.counts[k]++;
+    }
+}
+
+accumulation_t::accumulation_t(const Camera &cam, int block_size)
+    : width(cam.m_image_width), height(cam.image_height()), block_size(block_size),
+      blocks(Camera::create_tasks(width, height, block_size)), sums(size_t(width) * height * 3, 0.0f),
+      counts(blocks.size(), 0), locks(blocks.size())
+{
+}
+
+void accumulation_t::resolve_block(size_t k, std::vector<unsigned char> &pixels, int channels) const
+{
+    if (counts[k] == 0)
+        return;
+    const Task::block &b = blocks[k];
+    double scale = 1.0 / counts[k];
+    for (int j = b.y0; j < b.y1; j++)
+    {
+        for (int i = b.x0; i < b.x1; i++)
+        {
+            size_t p = size_t(j) * width + i;
+            Color sum(sums[p * 3], sums[p * 3 + 1], sums[p * 3 + 2]);
+            auto c = Color::prepare_color(sum * scale);
+            pixels[p * channels] = c.x();
+            pixels[p * channels + 1] = c.y();
+            pixels[p * channels + 2] = c.z();
         }
     }
 }
 
+std::vector<unsigned char> accumulation_t::resolve(int channels) const
+{
+    std::vector<unsigned char> image_data(size_t(width) * height * channels);
+    for (size_t k = 0; k < blocks.size(); k++)
+        resolve_block(k, image_data, channels);
+    return image_data;
+}
+
 std::vector<Task::block> Camera::create_tasks(int width, int height, int block_size)
 {
     std::vector<Task::block> blocks;
@@ -128,22 +173,47 @@ void Camera::render(const Hittable &world)
 
     // According to image dimension (w*h) do blocks for threads
     int block_size = 128;
-    std::vector<Task::block> blocks = create_tasks(m_image_width, m_image_height, block_size);
+    accumulation_t acc(*this, block_size);
     // Image dimensions and parameters
     const int channels = 3;
-    std::vector<unsigned char> image_data(m_image_width * m_image_height * channels);
-    std::vector<std::future<void>> futures;
-    for (auto &s : blocks)
-        futures.push_back(std::async(std::launch::async, &Task::render_block, Task(), s, std::ref(world),
-                                     std::ref(image_data), channels, std::ref(*this)));
 
-    while (!futures.empty())
+    std::unique_ptr<Checkpoint> checkpoint;
+    if (!m_checkpoint_path.empty())
+    {
+        checkpoint = std::make_unique<Checkpoint>(m_checkpoint_path, *this, world.fingerprint(utils::fnv_offset_basis),
+                                                  block_size, m_checkpoint_interval);
+        if (checkpoint->restore(acc))
+            std::clog << "Resuming from " << m_checkpoint_path << '\n';
+    }
+
+    // A fixed pool works through the blocks in order, so only the blocks in flight move between
+    // two checkpoints instead of every block of the image
+    std::atomic<size_t> next_block = 0, blocks_done = 0;
+    auto work = [&]
+    {
+        for (size_t k = next_block++; k < acc.blocks.size(); k = next_block++)
+        {
+            Task().sample_block(k, world, acc, *this, m_samples_per_pixel);
+            blocks_done++;
+        }
+    };
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < std::max(1u, std::thread::hardware_concurrency()); i++)
+        workers.emplace_back(work);
+
+    while (blocks_done < acc.blocks.size())
     {
-        std::clog << "\rBlocks remaining: " << futures.size() << ' ' << std::flush;
-        futures.back().get();
-        futures.pop_back();
+        std::clog << "\rBlocks remaining: " << acc.blocks.size() - blocks_done << ' ' << std::flush;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (checkpoint)
+            checkpoint->update(acc);
     }
+    workers.clear();
 
     std::clog << "\rDone.                 \n";
-    stbi_write_png("image.png", m_image_width, m_image_height, channels, image_data.data(), m_image_width * channels);
+    auto image_data = acc.resolve(channels);
+    if (stbi_write_png(m_output_path.c_str(), m_image_width, m_image_height, channels, image_data.data(),
+                       m_image_width * channels) &&
+        checkpoint)
+        checkpoint->remove();
 }
\ No newline at end of file
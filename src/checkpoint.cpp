@@ -0,0 +1,248 @@
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static_assert(sizeof(Checkpoint::header_t) == 40 + 13 * sizeof(double), "checkpoint header must not be padded");
+static_assert(sizeof(Checkpoint::record_t) == 16, "checkpoint record must not be padded");
+
+Checkpoint::Checkpoint(const std::string &path, const Camera &cam, uint64_t scene, int block_size, double interval)
+    : m_path(path), m_last_save(std::chrono::steady_clock::now()), m_interval(interval)
+{
+    m_header.width = cam.m_image_width;
+    m_header.height = cam.image_height();
+    m_header.samples_per_pixel = cam.m_samples_per_pixel;
+    m_header.max_depth = cam.m_max_depth;
+    m_header.block_size = block_size;
+    m_header.scene = scene;
+
+    const double camera[] = {cam.m_aspect_ratio, cam.m_vfov,       cam.m_lookfrom.x(), cam.m_lookfrom.y(),
+                             cam.m_lookfrom.z(), cam.m_lookat.x(), cam.m_lookat.y(),   cam.m_lookat.z(),
+                             cam.m_vup.x(),      cam.m_vup.y(),    cam.m_vup.z(),      cam.m_dof_angle,
+                             cam.m_focus_dist};
+    std::copy(std::begin(camera), std::end(camera), m_header.camera);
+
+    m_blocks = Camera::create_tasks(m_header.width, m_header.height, block_size);
+    m_first.push_back(0);
+    for (const auto &b : m_blocks)
+        m_first.push_back(m_first.back() + size_t(b.x1 - b.x0) * (b.y1 - b.y0) * 3);
+    m_counts.assign(m_blocks.size(), 0);
+    m_unsaved.assign(m_blocks.size(), false);
+}
+
+Checkpoint::~Checkpoint()
+{
+    if (m_writer.valid())
+        m_writer.get();
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+off_t Checkpoint::record_offset(size_t k) const
+{
+    return sizeof(header_t) + k * sizeof(record_t) + m_first[k] * sizeof(float);
+}
+
+uint64_t Checkpoint::checksum(size_t k) const
+{
+    uint64_t hash = utils::fnv1a(utils::fnv_offset_basis, m_counts[k]);
+    return utils::fnv1a(hash, &m_sums[m_first[k]], (m_first[k + 1] - m_first[k]) * sizeof(float));
+}
+
+bool Checkpoint::open_file()
+{
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+    {
+        std::perror(m_path.c_str());
+        return false;
+    }
+    if (m_reuse)
+        return true;
+
+    // A new file gets its full size up front, records never written read back as empty blocks
+    bool created = ftruncate(m_fd, 0) == 0 && ftruncate(m_fd, record_offset(m_blocks.size())) == 0 &&
+                   pwrite(m_fd, &m_header, sizeof(m_header), 0) == sizeof(m_header);
+    if (!created)
+    {
+        std::perror(m_path.c_str());
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_reuse = true;
+    return true;
+}
+
+bool Checkpoint::save()
+{
+    if (m_fd < 0 && !open_file())
+        return false;
+
+    for (size_t k = 0; k < m_blocks.size(); k++)
+    {
+        if (!m_unsaved[k])
+            continue;
+        record_t record;
+        record.count = m_counts[k];
+        record.checksum = checksum(k);
+        iovec parts[] = {{&record, sizeof(record)},
+                         {&m_sums[m_first[k]], (m_first[k + 1] - m_first[k]) * sizeof(float)}};
+        if (pwritev(m_fd, parts, 2, record_offset(k)) != ssize_t(parts[0].iov_len + parts[1].iov_len))
+        {
+            std::perror(m_path.c_str());
+            return false;
+        }
+        m_unsaved[k] = false;
+    }
+    if (fsync(m_fd) != 0)
+    {
+        std::perror(m_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Checkpoint::complete() const
+{
+    FILE *file = std::fopen(m_path.c_str(), "rb");
+    if (!file)
+        return false;
+    header_t stored;
+    bool read = std::fread(&stored, sizeof(stored), 1, file) == 1;
+    std::fclose(file);
+    bool complete = stored.complete;
+    stored.complete = m_header.complete;
+    return read && complete && stored == m_header;
+}
+
+bool Checkpoint::mark_complete()
+{
+    if (m_writer.valid())
+        m_writer.get();
+    if (m_fd < 0)
+        m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    // The header goes first, a crash before the truncation still leaves a valid marker
+    header_t marker = m_header;
+    marker.complete = 1;
+    bool marked = m_fd >= 0 && pwrite(m_fd, &marker, sizeof(marker), 0) == sizeof(marker) &&
+                  ftruncate(m_fd, sizeof(marker)) == 0 && fsync(m_fd) == 0;
+    if (!marked)
+        std::perror(m_path.c_str());
+    m_reuse = false;
+    return marked;
+}
+
+bool Checkpoint::restore(accumulation_t &acc)
+{
+    FILE *file = std::fopen(m_path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    header_t stored;
+    if (std::fread(&stored, sizeof(stored), 1, file) != 1 || stored.complete || !(stored == m_header))
+    {
+        if (!stored.complete)
+            std::cerr << "Ignoring checkpoint " << m_path << " written for another render\n";
+        std::fclose(file);
+        return false;
+    }
+    m_sums.assign(m_first.back(), 0.0f);
+
+    size_t damaged = 0;
+    for (size_t k = 0; k < m_blocks.size(); k++)
+    {
+        record_t record;
+        size_t size = m_first[k + 1] - m_first[k];
+        if (std::fread(&record, sizeof(record), 1, file) != 1 ||
+            std::fread(&m_sums[m_first[k]], sizeof(float), size, file) != size)
+        {
+            std::cerr << "Ignoring truncated checkpoint " << m_path << '\n';
+            std::fclose(file);
+            std::fill(m_sums.begin(), m_sums.end(), 0.0f);
+            std::fill(m_counts.begin(), m_counts.end(), 0);
+            return false;
+        }
+
+        // A record torn by a crash only costs that block
+        m_counts[k] = record.count;
+        if (record.count > 0 &&
+            (record.count > uint32_t(m_header.samples_per_pixel) || record.checksum != checksum(k)))
+        {
+            damaged++;
+            m_counts[k] = 0;
+        }
+        if (m_counts[k] == 0)
+            std::fill(m_sums.begin() + m_first[k], m_sums.begin() + m_first[k + 1], 0.0f);
+    }
+    std::fclose(file);
+    if (damaged > 0)
+        std::cerr << "Restarting " << damaged << " damaged blocks of checkpoint " << m_path << '\n';
+
+    for (size_t k = 0; k < m_blocks.size(); k++)
+    {
+        const Task::block &b = m_blocks[k];
+        size_t row = size_t(b.x1 - b.x0) * 3;
+        for (int j = b.y0; j < b.y1; j++)
+        {
+            auto from = m_sums.begin() + m_first[k] + (j - b.y0) * row;
+            std::copy(from, from + row, acc.sums.begin() + (size_t(j) * acc.width + b.x0) * 3);
+        }
+        acc.counts[k] = m_counts[k];
+    }
+    m_reuse = true;
+    return true;
+}
+
+void Checkpoint::update(accumulation_t &acc)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_last_save < std::chrono::duration<double>(m_interval))
+        return;
+    if (m_writer.valid())
+    {
+        if (m_writer.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;
+        m_writer.get();
+    }
+
+    if (m_sums.empty())
+        m_sums.assign(m_first.back(), 0.0f);
+    // Only blocks that completed a pass since the last snapshot are copied, each under its own lock
+    for (size_t k = 0; k < m_blocks.size(); k++)
+    {
+        std::lock_guard<std::mutex> guard(acc.locks[k]);
+        if (acc.counts[k] == m_counts[k])
+            continue;
+        const Task::block &b = m_blocks[k];
+        size_t row = size_t(b.x1 - b.x0) * 3;
+        for (int j = b.y0; j < b.y1; j++)
+        {
+            auto from = acc.sums.begin() + (size_t(j) * acc.width + b.x0) * 3;
+            std::copy(from, from + row, m_sums.begin() + m_first[k] + (j - b.y0) * row);
+        }
+        m_counts[k] = acc.counts[k];
+        m_unsaved[k] = true;
+    }
+
+    m_last_save = now;
+    // Records a failed save did not write are still pending
+    if (std::find(m_unsaved.begin(), m_unsaved.end(), true) == m_unsaved.end())
+        return;
+
+    // The snapshot is left alone until the writer is done with it
+    m_writer = std::async(std::launch::async, &Checkpoint::save, this);
+}
+
+void Checkpoint::remove()
+{
+    if (m_writer.valid())
+        m_writer.get();
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = -1;
+    std::remove(m_path.c_str());
+}
@@ -1,7 +1,9 @@
+#include "batch.hpp"
 #include "camera.hpp"
 #include "color.hpp"
 #include "hittable.hpp"
 #include "material.hpp"
+#include "preview.hpp"
 #include "ray.hpp"
 #include "sphere.hpp"
 #include "utils.hpp"
@@ -11,10 +13,40 @@
 #include <iostream>
 #include <memory>
 #include <random>
+#include <string>
 #include <vector>
 
 int main(int argc, char const *argv[])
 {
+    int serve_port = 0;
+    std::string batch_manifest;
+    std::string output_path = "image.png";
+    std::string checkpoint_path;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--serve" && i + 1 < argc && utils::parse_exact(argv[i + 1], serve_port) && serve_port >= 1 &&
+            serve_port <= 65535)
+            i++;
+        else if (arg == "--batch" && i + 1 < argc)
+            batch_manifest = argv[++i];
+        else if (arg == "--output" && i + 1 < argc)
+            output_path = argv[++i];
+        else if (arg == "--checkpoint" && i + 1 < argc)
+            checkpoint_path = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--output image.png] [--checkpoint file] [--batch manifest | --serve port(1-65535)]\n";
+            return 1;
+        }
+    }
+    if (serve_port > 0 && !batch_manifest.empty())
+    {
+        std::cerr << "--serve and --batch cannot be combined\n";
+        return 1;
+    }
+
     HittableList world;
     auto ground_material = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
     world.add(std::make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
@@ -78,5 +110,27 @@ int main(int argc, char const *argv[])
 
     cam.m_dof_angle = 0.6;
     cam.m_focus_dist = 10.0;
+    cam.m_output_path = output_path;
+    cam.m_checkpoint_path = checkpoint_path;
+
+    if (serve_port > 0 && !checkpoint_path.empty())
+    {
+        std::cerr << "--checkpoint does not apply to --serve\n";
+        return 1;
+    }
+    if (serve_port > 0)
+    {
+        PreviewServer server(world, cam);
+        server.m_port = serve_port;
+        return server.serve() ? 0 : 1;
+    }
+    if (!batch_manifest.empty())
+    {
+        Batch batch(world, cam);
+        batch.m_checkpoint_prefix = checkpoint_path;
+        if (!batch.load(batch_manifest))
+            return 1;
+        return batch.run() ? 0 : 1;
+    }
     cam.render(world);
 }
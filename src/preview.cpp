@@ -0,0 +1,361 @@
+#include "preview.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <stb_image_write.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static bool send_all(int fd, const void *data, size_t size)
+{
+    auto bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool PreviewServer::apply(const std::string &line)
+{
+    std::istringstream in(line);
+    std::string key, token;
+    std::vector<std::string> args;
+    if (!(in >> key))
+        return false;
+    while (in >> token)
+        args.push_back(token);
+
+    if (key == "lookfrom" || key == "lookat" || key == "vup")
+    {
+        double x, y, z;
+        if (args.size() != 3 || !utils::parse_exact(args[0], x) || !utils::parse_exact(args[1], y) ||
+            !utils::parse_exact(args[2], z))
+            return false;
+        Vec3 &target = key == "lookfrom" ? m_camera.m_lookfrom : key == "lookat" ? m_camera.m_lookat : m_camera.m_vup;
+        target = Vec3(x, y, z);
+        return true;
+    }
+    if (args.size() != 1)
+        return false;
+    if (key == "format")
+    {
+        if (args[0] != "png" && args[0] != "jpg")
+            return false;
+        m_format = args[0];
+        return true;
+    }
+
+    double value;
+    int count;
+    if (key == "vfov" && utils::parse_exact(args[0], value) && value > 0 && value < 180)
+        m_camera.m_vfov = value;
+    else if (key == "focus_dist" && utils::parse_exact(args[0], value) && value > 0)
+        m_camera.m_focus_dist = value;
+    else if (key == "dof_angle" && utils::parse_exact(args[0], value) && value >= 0)
+        m_camera.m_dof_angle = value;
+    else if (key == "samples" && utils::parse_exact(args[0], count) && count >= 1 && count <= Camera::max_samples)
+        m_camera.m_samples_per_pixel = count;
+    else if (key == "max_depth" && utils::parse_exact(args[0], count) && count >= 1 && count <= Camera::max_ray_depth)
+        m_camera.m_max_depth = count;
+    else if (key == "width" && utils::parse_exact(args[0], count) && count >= 1 && count <= Camera::max_image_size &&
+             count / m_camera.m_aspect_ratio <= Camera::max_image_size)
+        m_camera.m_image_width = count;
+    else
+        return false;
+    return true;
+}
+
+void PreviewServer::read_commands()
+{
+    std::string pending;
+    char buffer[512];
+    ssize_t n;
+    while ((n = recv(m_client, buffer, sizeof(buffer), 0)) > 0)
+    {
+        pending.append(buffer, n);
+        size_t end;
+        while ((end = pending.find('\n')) != std::string::npos)
+        {
+            std::string line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!apply(line))
+            {
+                std::clog << "Ignoring command: " << line << '\n';
+                continue;
+            }
+            // Tiles in flight poll m_cancel, the render loop then picks up the new camera
+            m_dirty = true;
+            m_cancel = true;
+            m_changed.notify_one();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_connected = false;
+    m_cancel = true;
+    m_changed.notify_one();
+}
+
+// Nearest neighbour resize, blocks not rendered yet at the new size show the previous result
+static void upscale(std::vector<unsigned char> &pixels, int width, int height, int new_width, int new_height)
+{
+    const int channels = 3;
+    std::vector<unsigned char> resized(size_t(new_width) * new_height * channels);
+    if (!pixels.empty())
+    {
+        for (int j = 0; j < new_height; j++)
+        {
+            for (int i = 0; i < new_width; i++)
+            {
+                size_t from = (size_t(j) * height / new_height * width + size_t(i) * width / new_width) * channels;
+                size_t to = (size_t(j) * new_width + i) * channels;
+                std::copy(pixels.begin() + from, pixels.begin() + from + channels, resized.begin() + to);
+            }
+        }
+    }
+    pixels = std::move(resized);
+}
+
+bool PreviewServer::render_pass(const Camera &cam, int sample, accumulation_t &acc, frame_t &frame,
+                                const std::string &format, Clock::time_point &last_frame)
+{
+    const int channels = 3;
+    auto start = Clock::now();
+    const auto &blocks = acc.blocks;
+
+    // A few workers go through the blocks in order, so blocks complete steadily during the pass
+    // and a frame due in the middle of it shows the finished ones
+    std::atomic<size_t> next_block = 0;
+    std::mutex finished_mutex;
+    std::condition_variable finished_changed;
+    std::vector<size_t> finished;
+    auto work = [&]
+    {
+        for (size_t k = next_block++; k < blocks.size(); k = next_block++)
+        {
+            Task().sample_block(k, m_world, acc, cam, sample);
+            std::lock_guard<std::mutex> lock(finished_mutex);
+            finished.push_back(k);
+            finished_changed.notify_one();
+        }
+    };
+    std::vector<std::jthread> workers;
+    for (int i = 0; i < m_threads; i++)
+        workers.emplace_back(work);
+
+    auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_frame_interval));
+    size_t remaining = blocks.size();
+    while (remaining > 0)
+    {
+        auto deadline = last_frame + interval;
+        std::vector<size_t> ready;
+        {
+            std::unique_lock<std::mutex> lock(finished_mutex);
+            finished_changed.wait_until(lock, deadline, [&] { return !finished.empty(); });
+            ready.swap(finished);
+        }
+        for (size_t k : ready)
+            if (!m_cancel)
+                acc.resolve_block(k, frame.pixels, channels);
+        remaining -= ready.size();
+
+        if (remaining > 0 && !m_cancel && Clock::now() >= deadline)
+        {
+            send_frame(frame, sample, format);
+            last_frame = Clock::now();
+        }
+    }
+    if (m_cancel)
+        return false;
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    m_pixel_rate = double(acc.width) * acc.height / std::max(elapsed.count(), 1e-6);
+    return true;
+}
+
+void PreviewServer::send_frame(const frame_t &frame, int samples, const std::string &format)
+{
+    const int channels = 3;
+    std::vector<unsigned char> encoded;
+    auto append = [](void *context, void *data, int size)
+    {
+        auto out = static_cast<std::vector<unsigned char> *>(context);
+        auto bytes = static_cast<unsigned char *>(data);
+        out->insert(out->end(), bytes, bytes + size);
+    };
+    if (format == "jpg")
+        stbi_write_jpg_to_func(append, &encoded, frame.width, frame.height, channels, frame.pixels.data(), 90);
+    else
+        stbi_write_png_to_func(append, &encoded, frame.width, frame.height, channels, frame.pixels.data(),
+                               frame.width * channels);
+
+    std::ostringstream header;
+    header << "FRAME " << m_sequence++ << ' ' << samples << ' ' << frame.width << ' ' << frame.height << ' '
+           << format << ' ' << encoded.size() << '\n';
+    std::string h = header.str();
+    encoded.insert(encoded.begin(), h.begin(), h.end());
+
+    // Replaces a frame the client has not taken yet, the renderer never waits on the socket
+    std::lock_guard<std::mutex> lock(m_send_mutex);
+    m_outgoing = std::move(encoded);
+    m_send_ready.notify_one();
+}
+
+void PreviewServer::send_frames()
+{
+    while (true)
+    {
+        std::vector<unsigned char> packet;
+        {
+            std::unique_lock<std::mutex> lock(m_send_mutex);
+            m_send_ready.wait(lock, [this] { return !m_outgoing.empty() || !m_sending; });
+            if (!m_sending)
+                return;
+            packet.swap(m_outgoing);
+        }
+        if (!send_all(m_client, packet.data(), packet.size()))
+        {
+            // Wakes up read_commands so the client gets dropped
+            shutdown(m_client, SHUT_RDWR);
+            return;
+        }
+    }
+}
+
+void PreviewServer::progressive(Camera cam, const std::string &format)
+{
+    // Pick the first width so that one sample fits in half the first frame budget,
+    // leaving the rest for encoding and transfer
+    const int full_width = cam.m_image_width;
+    double full_pixels = double(full_width) * (full_width / cam.m_aspect_ratio);
+    double budget_pixels = m_pixel_rate * m_first_frame_latency / 2;
+    int width = std::clamp(int(full_width * std::sqrt(budget_pixels / full_pixels)), std::min(16, full_width),
+                           full_width);
+
+    frame_t frame;
+    bool sent = false;
+    auto interval = std::chrono::duration<double>(m_frame_interval);
+    auto last_frame = Clock::now();
+    while (true)
+    {
+        cam.m_image_width = width;
+        cam.init();
+        upscale(frame.pixels, frame.width, frame.height, width, cam.image_height());
+        frame.width = width;
+        frame.height = cam.image_height();
+
+        accumulation_t acc(cam, block_size);
+        acc.cancel = &m_cancel;
+        int samples = width == full_width ? cam.m_samples_per_pixel : 1;
+        for (int s = 1; s <= samples; s++)
+        {
+            if (!render_pass(cam, s, acc, frame, format, last_frame))
+                return;
+
+            auto now = Clock::now();
+            if (!sent || (width == full_width && s == samples) || now - last_frame >= interval)
+            {
+                send_frame(frame, s, format);
+                sent = true;
+                last_frame = now;
+            }
+        }
+        if (width == full_width)
+            return;
+        width = std::min(2 * width, full_width);
+    }
+}
+
+bool PreviewServer::serve()
+{
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0)
+    {
+        perror("socket");
+        return false;
+    }
+    int yes = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(m_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(server, 1) < 0)
+    {
+        perror("bind");
+        close(server);
+        return false;
+    }
+    std::clog << "Preview server listening on 127.0.0.1:" << m_port << '\n';
+
+    while (true)
+    {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_client = client;
+            m_connected = true;
+            m_dirty = true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_send_mutex);
+            m_outgoing.clear();
+            m_sending = true;
+        }
+        std::clog << "Client connected\n";
+
+        std::thread reader(&PreviewServer::read_commands, this);
+        std::thread sender(&PreviewServer::send_frames, this);
+        while (true)
+        {
+            Camera cam;
+            std::string format;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [this] { return m_dirty || !m_connected; });
+                if (!m_connected)
+                    break;
+                cam = m_camera;
+                format = m_format;
+                m_dirty = false;
+                m_cancel = false;
+            }
+            try
+            {
+                progressive(cam, format);
+            }
+            catch (const std::exception &e)
+            {
+                // A request the machine cannot honour only drops that request, not the server
+                std::cerr << "Preview request dropped: " << e.what() << '\n';
+            }
+        }
+
+        reader.join();
+        {
+            std::lock_guard<std::mutex> lock(m_send_mutex);
+            m_sending = false;
+            m_send_ready.notify_one();
+        }
+        // Unblocks a send stuck on a client that stopped reading
+        shutdown(client, SHUT_RDWR);
+        sender.join();
+        close(client);
+        std::clog << "Client disconnected\n";
+    }
+}